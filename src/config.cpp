@@ -5,7 +5,36 @@
 
 namespace hydra {
 
-Config::Config() : listen_port_(8080), buffer_size_(65536) {}
+Config::Config()
+    : listen_port_(8080)
+    , buffer_size_(65536)
+    , capture_max_size_(256 * 1024 * 1024)
+    , idle_timeout_(60)
+    , max_requests_per_connection_(0)
+    , max_connections_(10000)
+    , drain_timeout_(30) {}
+
+// Finds "key": <number> in the content and stores the number in value
+static bool parse_number(const std::string& content, const std::string& key, size_t& value) {
+    size_t pos = content.find("\"" + key + "\"");
+    if (pos == std::string::npos) return false;
+    
+    pos = content.find(':', pos);
+    if (pos == std::string::npos) return false;
+    
+    std::string num_str;
+    pos++;
+    while (pos < content.length() && (std::isdigit(content[pos]) || std::isspace(content[pos]))) {
+        if (std::isdigit(content[pos])) {
+            num_str += content[pos];
+        }
+        pos++;
+    }
+    if (num_str.empty()) return false;
+    
+    value = std::stoull(num_str);
+    return true;
+}
 
 // Simple JSON parser for our specific format
 bool Config::load(const std::string& filename) {
@@ -59,6 +88,26 @@ bool Config::load(const std::string& filename) {
         }
     }
     
+    // Parse capture_file
+    pos = content.find("\"capture_file\"");
+    if (pos != std::string::npos) {
+        size_t start = content.find('\"', pos + 14);
+        if (start != std::string::npos) {
+            start++;
+            size_t end = content.find('\"', start);
+            if (end != std::string::npos) {
+                capture_file_ = content.substr(start, end - start);
+            }
+        }
+    }
+    
+    // Parse capture_max_size and connection limits
+    parse_number(content, "capture_max_size", capture_max_size_);
+    parse_number(content, "idle_timeout", idle_timeout_);
+    parse_number(content, "max_requests_per_connection", max_requests_per_connection_);
+    parse_number(content, "max_connections", max_connections_);
+    parse_number(content, "drain_timeout", drain_timeout_);
+    
     // Parse targets array
     pos = content.find("\"targets\"");
     if (pos != std::string::npos) {
@@ -122,6 +171,14 @@ bool Config::load(const std::string& filename) {
     std::cout << "Configuration loaded:" << std::endl;
     std::cout << "  Listen port: " << listen_port_ << std::endl;
     std::cout << "  Buffer size: " << buffer_size_ << std::endl;
+    if (!capture_file_.empty()) {
+        std::cout << "  Capture file: " << capture_file_ 
+                  << " (max " << capture_max_size_ << " bytes)" << std::endl;
+    }
+    std::cout << "  Idle timeout: " << idle_timeout_ << " s" << std::endl;
+    std::cout << "  Max requests per connection: " << max_requests_per_connection_ << std::endl;
+    std::cout << "  Max connections: " << max_connections_ << std::endl;
+    std::cout << "  Drain timeout: " << drain_timeout_ << " s" << std::endl;
     std::cout << "  Targets: " << targets_.size() << std::endl;
     for (const auto& target : targets_) {
         std::cout << "    - " << target.host << ":" << target.port << std::endl;
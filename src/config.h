@@ -20,11 +20,23 @@ public:
     uint16_t get_listen_port() const { return listen_port_; }
     size_t get_buffer_size() const { return buffer_size_; }
     const std::vector<Target>& get_targets() const { return targets_; }
+    const std::string& get_capture_file() const { return capture_file_; }
+    size_t get_capture_max_size() const { return capture_max_size_; }
+    size_t get_idle_timeout() const { return idle_timeout_; }
+    size_t get_max_requests_per_connection() const { return max_requests_per_connection_; }
+    size_t get_max_connections() const { return max_connections_; }
+    size_t get_drain_timeout() const { return drain_timeout_; }
 
 private:
     uint16_t listen_port_;
     size_t buffer_size_;
     std::vector<Target> targets_;
+    std::string capture_file_;
+    size_t capture_max_size_;
+    size_t idle_timeout_;                   // Seconds, 0 disables
+    size_t max_requests_per_connection_;    // 0 means unlimited
+    size_t max_connections_;                // 0 means unlimited
+    size_t drain_timeout_;                  // Seconds a shutdown waits for sessions
 };
 
 } // namespace hydra
@@ -0,0 +1,266 @@
+#include "handover.h"
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <cerrno>
+
+extern char** environ;
+#endif
+
+namespace hydra {
+
+#ifndef _WIN32
+
+static const char* HANDOVER_ENV = "HYDRA_HANDOVER_SOCKET";
+static const std::chrono::seconds HANDOVER_TIMEOUT(10);
+
+// Waits until fd is readable, giving up when the deadline passes or the
+// successor process exits. An exited successor is reaped here and flagged,
+// so its pid is never signalled after it may have been reused.
+static bool wait_readable(int fd, pid_t child, std::chrono::steady_clock::time_point deadline,
+                          bool& child_reaped) {
+    while (std::chrono::steady_clock::now() < deadline) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = poll(&pfd, 1, 100);
+        if (ready > 0) return true;
+        if (ready < 0 && errno != EINTR) return false;
+
+        if (waitpid(child, nullptr, WNOHANG) == child) {
+            child_reaped = true;
+            std::cerr << "Successor process exited during handover" << std::endl;
+            return false;
+        }
+    }
+    std::cerr << "Timed out waiting for successor process" << std::endl;
+    return false;
+}
+
+// Finds the program the way execvp would, but in the parent, so the child
+// only has to call execve
+static std::string resolve_executable(const std::string& program) {
+    if (program.find('/') != std::string::npos) return program;
+
+    const char* path = std::getenv("PATH");
+    std::string dirs = path != nullptr ? path : "/usr/local/bin:/usr/bin:/bin";
+    size_t start = 0;
+    while (start <= dirs.size()) {
+        size_t end = dirs.find(':', start);
+        if (end == std::string::npos) end = dirs.size();
+        std::string dir = dirs.substr(start, end - start);
+        std::string candidate = (dir.empty() ? std::string(".") : dir) + "/" + program;
+        if (access(candidate.c_str(), X_OK) == 0) return candidate;
+        start = end + 1;
+    }
+    return program;
+}
+
+// Copies this process's environment with the handover channel added.
+// The environment of the running process is never modified, since other
+// threads may be reading it (getaddrinfo does).
+static std::vector<std::string> successor_environment(int channel) {
+    std::vector<std::string> env;
+    std::string prefix = std::string(HANDOVER_ENV) + "=";
+    for (char** entry = environ; *entry != nullptr; ++entry) {
+        if (std::strncmp(*entry, prefix.c_str(), prefix.size()) != 0) {
+            env.push_back(*entry);
+        }
+    }
+    env.push_back(prefix + std::to_string(channel));
+    return env;
+}
+
+static bool send_socket(int channel, socket_t sock) {
+    char byte = 'L';
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), &sock, sizeof(int));
+
+    return sendmsg(channel, &msg, 0) == 1;
+}
+
+static socket_t receive_socket(int channel) {
+    char byte = 0;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(channel, &msg, 0) != 1) return INVALID_SOCKET;
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        return INVALID_SOCKET;
+    }
+
+    socket_t sock;
+    std::memcpy(&sock, CMSG_DATA(cmsg), sizeof(int));
+    return sock;
+}
+
+bool Handover::hand_over(const std::vector<std::string>& argv, socket_t listen_socket) {
+    if (argv.empty()) return false;
+
+    // The channel needs no path, so no other process can connect to it.
+    // Flagging both ends after socketpair() is safe: this thread is the only
+    // one that forks.
+    int channels[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, channels) == -1) {
+        std::cerr << "Failed to create handover channel: " << strerror(errno) << std::endl;
+        return false;
+    }
+    int channel = channels[0];
+    int child_channel = channels[1];
+    SocketUtils::set_close_on_exec(channel);
+    SocketUtils::set_close_on_exec(child_channel);
+
+    // Everything the child needs is prepared before fork()
+    std::string program = resolve_executable(argv[0]);
+    std::vector<char*> args;
+    for (const auto& arg : argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+    std::vector<std::string> env = successor_environment(child_channel);
+    std::vector<char*> envp;
+    for (const auto& entry : env) {
+        envp.push_back(const_cast<char*>(entry.c_str()));
+    }
+    envp.push_back(nullptr);
+
+    // Every descriptor of this process is close-on-exec, so the successor
+    // keeps no client or upstream connection open, only its channel end
+    pid_t child = SocketUtils::fork_process();
+    if (child == 0) {
+        fcntl(child_channel, F_SETFD, 0);
+        execve(program.c_str(), args.data(), envp.data());
+        _exit(127);
+    }
+    close(child_channel);
+
+    if (child == -1) {
+        std::cerr << "Failed to start successor: " << strerror(errno) << std::endl;
+        close(channel);
+        return false;
+    }
+
+    std::cout << "Started successor process " << child << std::endl;
+
+    // The successor reads the listening socket once it has started; an
+    // exited successor shows up as end of file on the channel
+    auto deadline = std::chrono::steady_clock::now() + HANDOVER_TIMEOUT;
+    bool success = false;
+    bool child_reaped = false;
+
+    if (send_socket(channel, listen_socket) &&
+        wait_readable(channel, child, deadline, child_reaped)) {
+        char ack = 0;
+        success = recv(channel, &ack, 1, 0) == 1 && ack == 'R';
+    }
+
+    close(channel);
+
+    if (!success) {
+        std::cerr << "Handover to successor failed" << std::endl;
+        if (!child_reaped) {
+            kill(child, SIGTERM);
+            waitpid(child, nullptr, 0);
+        }
+    }
+
+    return success;
+}
+
+socket_t Handover::receive_listener(int& channel) {
+    channel = -1;
+
+    const char* value = std::getenv(HANDOVER_ENV);
+    if (value == nullptr) return INVALID_SOCKET;
+
+    std::string text = value;
+    unsetenv(HANDOVER_ENV);
+
+    char* end = nullptr;
+    long fd = std::strtol(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || fd <= 2 || fd > INT_MAX) {
+        std::cerr << "Invalid handover channel: " << text << std::endl;
+        return INVALID_SOCKET;
+    }
+
+    int sock = static_cast<int>(fd);
+    socket_t listen_socket = receive_socket(sock);
+    if (listen_socket == INVALID_SOCKET) {
+        std::cerr << "Failed to receive listening socket from predecessor" << std::endl;
+        close(sock);
+        return INVALID_SOCKET;
+    }
+
+    SocketUtils::set_close_on_exec(listen_socket);
+    SocketUtils::set_close_on_exec(sock);
+    std::cout << "Took over listening socket from predecessor" << std::endl;
+    channel = sock;
+    return listen_socket;
+}
+
+void Handover::confirm_ready(int channel) {
+    if (channel == -1) return;
+
+    char ack = 'R';
+    if (send(channel, &ack, 1, 0) != 1) {
+        std::cerr << "Failed to confirm handover: " << strerror(errno) << std::endl;
+    }
+    close(channel);
+}
+
+#else
+
+bool Handover::hand_over(const std::vector<std::string>&, socket_t) {
+    std::cerr << "Binary upgrade is not supported on Windows" << std::endl;
+    return false;
+}
+
+socket_t Handover::receive_listener(int& channel) {
+    channel = -1;
+    return INVALID_SOCKET;
+}
+
+void Handover::confirm_ready(int) {
+}
+
+#endif
+
+} // namespace hydra
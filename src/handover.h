@@ -0,0 +1,30 @@
+#ifndef HYDRA_HANDOVER_H
+#define HYDRA_HANDOVER_H
+
+#include <string>
+#include <vector>
+#include "socket_utils.h"
+
+namespace hydra {
+
+// Passes the listening socket from a running Hydra to a freshly exec'd one
+// over a Unix domain socket (SCM_RIGHTS), so upgrades never refuse clients.
+//
+// Old process: hand_over() starts the successor with one end of a socket
+// pair, whose descriptor number it passes in HYDRA_HANDOVER_SOCKET, sends
+// it the listening socket and waits until it reports ready.
+// New process: receive_listener() picks the socket up during startup and
+// confirm_ready() tells the old process it can stop accepting and drain.
+//
+// Only available on POSIX systems.
+class Handover {
+public:
+    static bool hand_over(const std::vector<std::string>& argv, socket_t listen_socket);
+
+    static socket_t receive_listener(int& channel);
+    static void confirm_ready(int channel);
+};
+
+} // namespace hydra
+
+#endif // HYDRA_HANDOVER_H
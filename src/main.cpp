@@ -2,17 +2,23 @@
 #include <csignal>
 #include "config.h"
 #include "proxy_server.h"
+#include "handover.h"
 
 // Global server pointer for signal handler
 hydra::ProxyServer* g_server = nullptr;
 
+// Only async-signal-safe work here; the server reacts in its accept loop
 void signal_handler(int signal) {
+    if (!g_server) return;
+    
     if (signal == SIGINT || signal == SIGTERM) {
-        std::cout << "\nShutting down server..." << std::endl;
-        if (g_server) {
-            g_server->stop();
-        }
+        g_server->request_shutdown();
+    }
+#ifndef _WIN32
+    else if (signal == SIGUSR2) {
+        g_server->request_upgrade();
     }
+#endif
 }
 
 int main(int argc, char* argv[]) {
@@ -50,21 +56,37 @@ int main(int argc, char* argv[]) {
         
         std::cout << std::endl;
         
+        // Take over the listening socket when started by a binary upgrade
+        int handover_channel = -1;
+        socket_t inherited_socket = hydra::Handover::receive_listener(handover_channel);
+        
         // Create the proxy server
-        hydra::ProxyServer server(config);
+        hydra::ProxyServer server(config, inherited_socket);
+        server.enable_upgrade(std::vector<std::string>(argv, argv + argc));
         g_server = &server;
         
-        // Set up signal handler for graceful shutdown
+        // Set up signal handler for graceful shutdown and upgrades
         std::signal(SIGINT, signal_handler);
         std::signal(SIGTERM, signal_handler);
+#ifndef _WIN32
+        std::signal(SIGUSR2, signal_handler);
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        
+        // The predecessor stops accepting once we are ready
+        hydra::Handover::confirm_ready(handover_channel);
         
         std::cout << std::endl;
         std::cout << "Press Ctrl+C to stop the server" << std::endl;
+#ifndef _WIN32
+        std::cout << "Send SIGUSR2 to upgrade without downtime" << std::endl;
+#endif
         std::cout << "==================================" << std::endl;
         std::cout << std::endl;
         
         // Run the server (blocks until stopped)
         server.run();
+        g_server = nullptr;
         
     } catch (std::exception& e) {
         std::cerr << "Exception: " << e.what() << std::endl;
@@ -1,4 +1,5 @@
 #include "proxy_server.h"
+#include "handover.h"
 #include <iostream>
 #include <thread>
 #include <chrono>
@@ -7,63 +8,186 @@
 
 namespace hydra {
 
-// SocketUtils implementation
-bool SocketUtils::initialize() {
-#ifdef _WIN32
-    WSADATA wsa_data;
-    return WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
-#else
+// ConnectionTracker implementation
+static const size_t TIMER_WHEEL_SLOTS = 512;
+
+ConnectionTracker::ConnectionTracker(size_t max_connections,
+                                     std::chrono::milliseconds idle_timeout,
+                                     std::chrono::milliseconds drain_timeout)
+    : max_connections_(max_connections)
+    , timeout_ticks_((idle_timeout.count() + tick_interval().count() - 1) / tick_interval().count())
+    , current_tick_(0)
+    , closing_(false)
+    , drain_timeout_(drain_timeout)
+    , last_tick_(std::chrono::steady_clock::now())
+    , wheel_(TIMER_WHEEL_SLOTS) {
+}
+
+bool ConnectionTracker::add(uint64_t id, socket_t sock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (closing_) return false;
+    
+    // At the cap, make room by closing the least recently used idle connection
+    if (max_connections_ > 0 && entries_.size() >= max_connections_) {
+        if (lru_.empty()) {
+            return false;
+        }
+        close_entry(lru_.front());
+    }
+    
+    // A queued connection may already have its request waiting in the kernel,
+    // so it only becomes idle once a worker starts reading from it
+    Entry entry;
+    entry.socket = sock;
+    entry.idle = false;
+    entry.served = false;
+    entry.deadline_tick = 0;
+    entries_.emplace(id, entry);
     return true;
-#endif
 }
 
-void SocketUtils::cleanup() {
-#ifdef _WIN32
-    WSACleanup();
-#endif
+void ConnectionTracker::remove(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(id);
+    if (it == entries_.end()) return;
+    
+    disarm(it->second);
+    entries_.erase(it);
 }
 
-void SocketUtils::close_socket(socket_t sock) {
-    if (sock != INVALID_SOCKET) {
-#ifdef _WIN32
-        closesocket(sock);
-#else
-        close(sock);
-#endif
+void ConnectionTracker::set_busy(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+        disarm(it->second);
+        it->second.served = true;
     }
 }
 
-bool SocketUtils::set_non_blocking(socket_t sock) {
-#ifdef _WIN32
-    u_long mode = 1;
-    return ioctlsocket(sock, FIONBIO, &mode) == 0;
-#else
-    int flags = fcntl(sock, F_GETFL, 0);
-    if (flags == -1) return false;
-    return fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
-#endif
+bool ConnectionTracker::set_idle(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto it = entries_.find(id);
+    if (it == entries_.end()) return false;
+    
+    // While draining, only a first request that has already arrived is read
+    if (closing_) {
+        if (!it->second.served && SocketUtils::has_pending_data(it->second.socket)) {
+            return true;
+        }
+        close_entry(id);
+        return false;
+    }
+    
+    disarm(it->second);
+    arm(id, it->second);
+    return true;
 }
 
-bool SocketUtils::set_no_delay(socket_t sock) {
-    int flag = 1;
-    return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, 
-                     (char*)&flag, sizeof(flag)) == 0;
+void ConnectionTracker::tick() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto now = std::chrono::steady_clock::now();
+    
+    // Connections still open when the drain deadline passes are closed, busy or not
+    if (closing_ && now >= drain_deadline_ && !entries_.empty()) {
+        std::cerr << "Drain timeout reached, closing " << entries_.size() << " connections" << std::endl;
+        while (!entries_.empty()) {
+            close_entry(entries_.begin()->first);
+        }
+    }
+    
+    uint64_t elapsed = static_cast<uint64_t>((now - last_tick_) / tick_interval());
+    if (elapsed == 0) return;
+    last_tick_ += elapsed * tick_interval();
+    
+    // After a long stall one full turn of the wheel visits every slot
+    uint64_t target_tick = current_tick_ + elapsed;
+    uint64_t steps = elapsed < wheel_.size() ? elapsed : wheel_.size();
+    current_tick_ = target_tick - steps;
+    
+    for (uint64_t i = 0; i < steps; ++i) {
+        current_tick_++;
+        auto& slot = wheel_[current_tick_ % wheel_.size()];
+        for (auto it = slot.begin(); it != slot.end(); ) {
+            uint64_t id = *it++;
+            if (entries_.find(id)->second.deadline_tick <= current_tick_) {
+                close_entry(id);
+            }
+        }
+    }
+}
+
+void ConnectionTracker::drain() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (closing_) return;
+    closing_ = true;
+    drain_deadline_ = std::chrono::steady_clock::now() + drain_timeout_;
+    
+    // A connection that was never served may already have its first request
+    // waiting; it is answered once and then closed
+    for (auto it = lru_.begin(); it != lru_.end(); ) {
+        uint64_t id = *it++;
+        Entry& entry = entries_.find(id)->second;
+        if (entry.served || !SocketUtils::has_pending_data(entry.socket)) {
+            close_entry(id);
+        }
+    }
+}
+
+bool ConnectionTracker::is_closing() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closing_;
+}
+
+void ConnectionTracker::arm(uint64_t id, Entry& entry) {
+    entry.idle = true;
+    entry.lru_it = lru_.insert(lru_.end(), id);
+    if (timeout_ticks_ > 0) {
+        entry.deadline_tick = current_tick_ + timeout_ticks_;
+        auto& slot = wheel_[entry.deadline_tick % wheel_.size()];
+        entry.wheel_it = slot.insert(slot.end(), id);
+    }
+}
+
+void ConnectionTracker::disarm(Entry& entry) {
+    if (!entry.idle) return;
+    
+    lru_.erase(entry.lru_it);
+    if (timeout_ticks_ > 0) {
+        wheel_[entry.deadline_tick % wheel_.size()].erase(entry.wheel_it);
+    }
+    entry.idle = false;
 }
 
-bool SocketUtils::set_reuse_addr(socket_t sock) {
-    int flag = 1;
-    return setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, 
-                     (char*)&flag, sizeof(flag)) == 0;
+void ConnectionTracker::close_entry(uint64_t id) {
+    // The session still owns the socket; it closes it once recv() returns
+    auto it = entries_.find(id);
+    SocketUtils::shutdown_socket(it->second.socket);
+    disarm(it->second);
+    entries_.erase(it);
 }
 
 // ProxySession implementation
 ProxySession::ProxySession(socket_t socket, 
                            const std::vector<Target>& targets,
-                           size_t buffer_size)
+                           size_t buffer_size,
+                           uint64_t connection_id,
+                           TrafficCapture* capture,
+                           ConnectionTracker& tracker,
+                           size_t max_requests)
     : socket_(socket)
     , targets_(targets)
     , buffer_(buffer_size)
-    , buffer_size_(buffer_size) {
+    , buffer_size_(buffer_size)
+    , connection_id_(connection_id)
+    , capture_(capture)
+    , tracker_(tracker)
+    , max_requests_(max_requests) {
 }
 
 void ProxySession::start() {
@@ -72,7 +196,12 @@ void ProxySession::start() {
 }
 
 void ProxySession::handle_client() {
-    while (true) {
+    size_t requests_served = 0;
+    
+    // Start the idle timer now that this worker waits for the first request
+    bool keep_alive = tracker_.set_idle(connection_id_);
+    
+    while (keep_alive) {
 #ifdef _WIN32
         int bytes_read = recv(socket_, buffer_.data(), (int)buffer_size_, 0);
 #else
@@ -80,6 +209,17 @@ void ProxySession::handle_client() {
 #endif
         
         if (bytes_read > 0) {
+            tracker_.set_busy(connection_id_);
+            
+            requests_served++;
+            if ((max_requests_ > 0 && requests_served >= max_requests_) || tracker_.is_closing()) {
+                keep_alive = false;
+            }
+            
+            if (capture_) {
+                capture_->record(connection_id_, buffer_.data(), static_cast<size_t>(bytes_read));
+            }
+            
             // Broadcast the data to all targets
             broadcast_to_targets(buffer_, bytes_read);
             
@@ -101,7 +241,7 @@ void ProxySession::handle_client() {
             std::string http_response = 
                 "HTTP/1.1 200 OK\r\n"
                 "Content-Length: " + std::to_string(body_length) + "\r\n"
-                "Connection: keep-alive\r\n"
+                "Connection: " + std::string(keep_alive ? "keep-alive" : "close") + "\r\n"
                 "\r\n";
             
             // Send HTTP headers
@@ -145,6 +285,10 @@ void ProxySession::handle_client() {
                     total_sent += sent;
                 }
             }
+            
+            if (!tracker_.set_idle(connection_id_)) {
+                keep_alive = false;
+            }
         } else if (bytes_read == 0) {
             // Connection closed
             break;
@@ -164,6 +308,7 @@ void ProxySession::handle_client() {
         }
     }
     
+    tracker_.remove(connection_id_);
     SocketUtils::close_socket(socket_);
 }
 
@@ -190,7 +335,7 @@ void ProxySession::broadcast_to_targets(const std::vector<char>& data, size_t le
             }
             
             // Create socket
-            socket_t target_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+            socket_t target_socket = SocketUtils::create_socket(result->ai_family, result->ai_socktype, result->ai_protocol);
             if (target_socket == INVALID_SOCKET) {
                 std::cerr << "Failed to create socket for " << target.host << ":" << target.port << std::endl;
                 freeaddrinfo(result);
@@ -256,54 +401,76 @@ void ProxySession::broadcast_to_targets(const std::vector<char>& data, size_t le
 }
 
 // ProxyServer implementation
-ProxyServer::ProxyServer(const Config& config)
-    : listen_socket_(INVALID_SOCKET)
+ProxyServer::ProxyServer(const Config& config, socket_t inherited_listen_socket)
+    : listen_socket_(inherited_listen_socket)
     , config_(config)
-    , running_(false) {
+    , running_(false)
+    , reaping_(false)
+    , pending_request_(REQUEST_NONE)
+    , upgrade_state_(UPGRADE_IDLE)
+    , tracker_(config.get_max_connections(),
+               std::chrono::seconds(config.get_idle_timeout()),
+               std::chrono::seconds(config.get_drain_timeout()))
+    , next_connection_id_(1) {
+    
+    static_assert(std::atomic<int>::is_always_lock_free, "signal handlers need a lock-free atomic");
     
     SocketUtils::initialize();
     
-    // Create listening socket
-    listen_socket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    // A socket handed over by a previous Hydra process is already listening
     if (listen_socket_ == INVALID_SOCKET) {
-        throw std::runtime_error("Failed to create listening socket");
-    }
-    
-    // Set socket options
-    SocketUtils::set_reuse_addr(listen_socket_);
-    
-    // Bind to port
-    struct sockaddr_in server_addr;
-    std::memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(config_.get_listen_port());
-    
-    if (bind(listen_socket_, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
-        SocketUtils::close_socket(listen_socket_);
-        throw std::runtime_error("Failed to bind to port " + std::to_string(config_.get_listen_port()));
-    }
-    
-    // Listen for connections
-    if (listen(listen_socket_, SOMAXCONN) == SOCKET_ERROR) {
-        SocketUtils::close_socket(listen_socket_);
-        throw std::runtime_error("Failed to listen on socket");
+        // Create listening socket
+        listen_socket_ = SocketUtils::create_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listen_socket_ == INVALID_SOCKET) {
+            throw std::runtime_error("Failed to create listening socket");
+        }
+        
+        // Set socket options
+        SocketUtils::set_reuse_addr(listen_socket_);
+        
+        // Bind to port
+        struct sockaddr_in server_addr;
+        std::memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(config_.get_listen_port());
+        
+        if (bind(listen_socket_, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
+            SocketUtils::close_socket(listen_socket_);
+            throw std::runtime_error("Failed to bind to port " + std::to_string(config_.get_listen_port()));
+        }
+        
+        // Listen for connections
+        if (listen(listen_socket_, SOMAXCONN) == SOCKET_ERROR) {
+            SocketUtils::close_socket(listen_socket_);
+            throw std::runtime_error("Failed to listen on socket");
+        }
     }
     
     std::cout << "Hydra proxy server listening on port " 
               << config_.get_listen_port() << std::endl;
     std::cout << "Broadcasting to " << config_.get_targets().size() 
               << " targets" << std::endl;
+    
+    if (!config_.get_capture_file().empty()) {
+        if (capture_.open(config_.get_capture_file(), config_.get_capture_max_size())) {
+            std::cout << "Capturing traffic to " << capture_.get_filename() << std::endl;
+        } else {
+            std::cerr << "Traffic capture disabled" << std::endl;
+        }
+    }
 }
 
 ProxyServer::~ProxyServer() {
     stop();
+    capture_.close();
     SocketUtils::close_socket(listen_socket_);
     SocketUtils::cleanup();
 }
 
 void ProxyServer::run() {
     running_ = true;
+    reaping_ = true;
     
     // Create worker threads
     unsigned int thread_count = std::thread::hardware_concurrency();
@@ -315,11 +482,36 @@ void ProxyServer::run() {
         worker_threads_.emplace_back(&ProxyServer::worker_thread, this);
     }
     
-    // Accept connections in main thread
+    reaper_thread_ = std::thread(&ProxyServer::reaper_thread, this);
+    
+    // Accept connections in main thread until shutdown or a successful upgrade
     accept_connections();
+    
+    // A handover still running when shutdown was requested needs the
+    // listening socket until it has finished
+    if (upgrade_thread_.joinable()) {
+        upgrade_thread_.join();
+    }
+    
+    // The successor records into its own capture file from now on
+    if (upgrade_state_ == UPGRADE_SUCCEEDED) {
+        capture_.set_recording(false);
+    }
+    
+    // After a handover the successor keeps the listening socket open
+    std::cout << "Shutting down server, draining sessions..." << std::endl;
+    SocketUtils::close_socket(listen_socket_);
+    listen_socket_ = INVALID_SOCKET;
+    
+    stop();
+    std::cout << "All sessions drained" << std::endl;
 }
 
 void ProxyServer::stop() {
+    // Idle connections are closed now, busy ones after their current request,
+    // and whatever is left once the drain timeout passes
+    tracker_.drain();
+    
     running_ = false;
     queue_cv_.notify_all();
     
@@ -328,19 +520,53 @@ void ProxyServer::stop() {
             thread.join();
         }
     }
+    
+    // Keep reaping idle connections until every session has ended
+    reaping_ = false;
+    if (reaper_thread_.joinable()) {
+        reaper_thread_.join();
+    }
 }
 
 void ProxyServer::accept_connections() {
-    while (running_) {
+    while (pending_request_ != REQUEST_SHUTDOWN) {
+        // Clients keep being accepted until the successor reports ready
+        if (pending_request_ == REQUEST_UPGRADE && upgrade_state_ == UPGRADE_IDLE) {
+            std::cout << "Handing over to a new Hydra process..." << std::endl;
+            upgrade_state_ = UPGRADE_RUNNING;
+            upgrade_thread_ = std::thread(&ProxyServer::upgrade_thread, this);
+        }
+        
+        if (upgrade_state_ == UPGRADE_SUCCEEDED) return;
+        
+        if (upgrade_state_ == UPGRADE_FAILED) {
+            upgrade_thread_.join();
+            std::cerr << "Upgrade failed, still accepting connections" << std::endl;
+            upgrade_state_ = UPGRADE_IDLE;
+            int expected = REQUEST_UPGRADE;
+            pending_request_.compare_exchange_strong(expected, REQUEST_NONE);
+        }
+        
+        // Wake up regularly to notice shutdown and upgrade requests
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(listen_socket_, &read_set);
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;
+        
+        if (select((int)listen_socket_ + 1, &read_set, nullptr, nullptr, &timeout) <= 0) {
+            continue;
+        }
+        
         struct sockaddr_in client_addr;
         socklen_t client_len = sizeof(client_addr);
         
-        socket_t client_socket = accept(listen_socket_, 
-                                       (struct sockaddr*)&client_addr, 
-                                       &client_len);
+        socket_t client_socket = SocketUtils::accept_socket(listen_socket_, 
+                                                            (struct sockaddr*)&client_addr, 
+                                                            &client_len);
         
         if (client_socket == INVALID_SOCKET) {
-            if (!running_) break;
 #ifdef _WIN32
             std::cerr << "Accept error: " << WSAGetLastError() << std::endl;
 #else
@@ -349,6 +575,14 @@ void ProxyServer::accept_connections() {
             continue;
         }
         
+        // Enforce the connection cap, evicting idle connections first
+        uint64_t connection_id = next_connection_id_++;
+        if (!tracker_.add(connection_id, client_socket)) {
+            std::cerr << "Connection limit reached, rejecting client" << std::endl;
+            SocketUtils::close_socket(client_socket);
+            continue;
+        }
+        
         // Set TCP_NODELAY for low latency
         SocketUtils::set_no_delay(client_socket);
         
@@ -356,7 +590,11 @@ void ProxyServer::accept_connections() {
         auto session = std::make_shared<ProxySession>(
             client_socket,
             config_.get_targets(),
-            config_.get_buffer_size()
+            config_.get_buffer_size(),
+            connection_id,
+            capture_.is_open() ? &capture_ : nullptr,
+            tracker_,
+            config_.get_max_requests_per_connection()
         );
         
         {
@@ -368,24 +606,34 @@ void ProxyServer::accept_connections() {
 }
 
 void ProxyServer::worker_thread() {
-    while (running_) {
+    // Queued sessions are still served after stop() so none is dropped
+    while (true) {
         std::shared_ptr<ProxySession> session;
         
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
             queue_cv_.wait(lock, [this] { return !session_queue_.empty() || !running_; });
             
-            if (!running_ && session_queue_.empty()) break;
+            if (session_queue_.empty()) break;
             
-            if (!session_queue_.empty()) {
-                session = session_queue_.front();
-                session_queue_.pop();
-            }
+            session = session_queue_.front();
+            session_queue_.pop();
         }
         
-        if (session) {
-            session->start();
-        }
+        session->start();
+    }
+}
+
+void ProxyServer::upgrade_thread() {
+    bool success = !upgrade_argv_.empty() &&
+        Handover::hand_over(upgrade_argv_, listen_socket_);
+    upgrade_state_ = success ? UPGRADE_SUCCEEDED : UPGRADE_FAILED;
+}
+
+void ProxyServer::reaper_thread() {
+    while (reaping_) {
+        std::this_thread::sleep_for(ConnectionTracker::tick_interval());
+        tracker_.tick();
     }
 }
 
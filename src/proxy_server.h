@@ -8,45 +8,75 @@
 #include <mutex>
 #include <queue>
 #include <condition_variable>
+#include <unordered_map>
+#include <list>
+#include <chrono>
+#include <string>
 #include "config.h"
-
-#ifdef _WIN32
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#ifdef _MSC_VER
-#pragma comment(lib, "ws2_32.lib")
-#endif
-typedef SOCKET socket_t;
-#else
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netinet/tcp.h>
-#include <arpa/inet.h>
-#include <netdb.h>
-#include <unistd.h>
-#include <fcntl.h>
-typedef int socket_t;
-#define INVALID_SOCKET -1
-#define SOCKET_ERROR -1
-#endif
+#include "traffic_capture.h"
+#include "socket_utils.h"
 
 namespace hydra {
 
-class SocketUtils {
+// Tracks open client connections and closes the ones that stay idle.
+// A connection is idle while a worker waits in recv() for its next request;
+// connections still waiting in the session queue are never idle.
+// Idle deadlines live in a hashed timing wheel, and idle connections are
+// also kept in LRU order so the oldest one can be evicted when the
+// connection cap is reached. Connections are closed with shutdown(), which
+// wakes up the worker blocked in recv() so it can clean up the session.
+class ConnectionTracker {
 public:
-    static bool initialize();
-    static void cleanup();
-    static void close_socket(socket_t sock);
-    static bool set_non_blocking(socket_t sock);
-    static bool set_no_delay(socket_t sock);
-    static bool set_reuse_addr(socket_t sock);
+    ConnectionTracker(size_t max_connections,
+                      std::chrono::milliseconds idle_timeout,
+                      std::chrono::milliseconds drain_timeout);
+    
+    bool add(uint64_t id, socket_t sock);
+    void remove(uint64_t id);
+    void set_busy(uint64_t id);
+    bool set_idle(uint64_t id);
+    void tick();
+    void drain();
+    bool is_closing();
+    
+    static std::chrono::milliseconds tick_interval() { return std::chrono::milliseconds(100); }
+
+private:
+    struct Entry {
+        socket_t socket;
+        bool idle;
+        bool served;                // At least one request answered
+        uint64_t deadline_tick;
+        std::list<uint64_t>::iterator wheel_it;
+        std::list<uint64_t>::iterator lru_it;
+    };
+    
+    void arm(uint64_t id, Entry& entry);
+    void disarm(Entry& entry);
+    void close_entry(uint64_t id);
+    
+    size_t max_connections_;
+    uint64_t timeout_ticks_;        // 0 disables idle reaping
+    uint64_t current_tick_;
+    bool closing_;                  // Set once the server drains; no connection may go idle
+    std::chrono::milliseconds drain_timeout_;
+    std::chrono::steady_clock::time_point drain_deadline_;
+    std::chrono::steady_clock::time_point last_tick_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::vector<std::list<uint64_t>> wheel_;
+    std::list<uint64_t> lru_;       // Idle connections, least recently used first
+    std::mutex mutex_;
 };
 
 class ProxySession : public std::enable_shared_from_this<ProxySession> {
 public:
     ProxySession(socket_t socket, 
                  const std::vector<Target>& targets,
-                 size_t buffer_size);
+                 size_t buffer_size,
+                 uint64_t connection_id,
+                 TrafficCapture* capture,
+                 ConnectionTracker& tracker,
+                 size_t max_requests);
     
     void start();
     socket_t get_socket() const { return socket_; }
@@ -59,27 +89,50 @@ private:
     const std::vector<Target>& targets_;
     std::vector<char> buffer_;
     size_t buffer_size_;
+    uint64_t connection_id_;
+    TrafficCapture* capture_;   // nullptr when capture is disabled
+    ConnectionTracker& tracker_;
+    size_t max_requests_;       // 0 means unlimited
 };
 
 class ProxyServer {
 public:
-    ProxyServer(const Config& config);
+    ProxyServer(const Config& config, socket_t inherited_listen_socket = INVALID_SOCKET);
     ~ProxyServer();
     
     void run();
     void stop();
+    void enable_upgrade(const std::vector<std::string>& argv) { upgrade_argv_ = argv; }
+    
+    // Only store an atomic flag, so they are safe to call from a signal handler
+    void request_shutdown() { pending_request_ = REQUEST_SHUTDOWN; }
+    void request_upgrade() { pending_request_ = REQUEST_UPGRADE; }
 
 private:
+    enum Request { REQUEST_NONE, REQUEST_SHUTDOWN, REQUEST_UPGRADE };
+    enum UpgradeState { UPGRADE_IDLE, UPGRADE_RUNNING, UPGRADE_SUCCEEDED, UPGRADE_FAILED };
+    
     void accept_connections();
     void worker_thread();
+    void reaper_thread();
+    void upgrade_thread();
     
     socket_t listen_socket_;
     const Config& config_;
     std::atomic<bool> running_;
+    std::atomic<bool> reaping_;
+    std::atomic<int> pending_request_;
+    std::vector<std::string> upgrade_argv_;
     std::vector<std::thread> worker_threads_;
+    std::thread reaper_thread_;
+    std::thread upgrade_thread_;    // Hands over while the accept loop keeps running
+    std::atomic<int> upgrade_state_;
     std::queue<std::shared_ptr<ProxySession>> session_queue_;
     std::mutex queue_mutex_;
     std::condition_variable queue_cv_;
+    TrafficCapture capture_;
+    ConnectionTracker tracker_;
+    uint64_t next_connection_id_;
 };
 
 } // namespace hydra
@@ -0,0 +1,138 @@
+#include "socket_utils.h"
+
+#ifndef _WIN32
+#include <sys/ioctl.h>
+#include <mutex>
+#include <shared_mutex>
+#endif
+
+// accept4() and SOCK_CLOEXEC are not available everywhere (macOS lacks both)
+#if defined(SOCK_CLOEXEC) && (defined(__linux__) || defined(__FreeBSD__))
+#define HYDRA_ATOMIC_CLOEXEC 1
+#endif
+
+namespace hydra {
+
+#if !defined(_WIN32) && !defined(HYDRA_ATOMIC_CLOEXEC)
+// Held shared while a socket is created and flagged, exclusively across fork()
+static std::shared_mutex descriptor_mutex;
+#endif
+
+// SocketUtils implementation
+bool SocketUtils::initialize() {
+#ifdef _WIN32
+    WSADATA wsa_data;
+    return WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0;
+#else
+    return true;
+#endif
+}
+
+void SocketUtils::cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void SocketUtils::close_socket(socket_t sock) {
+    if (sock != INVALID_SOCKET) {
+#ifdef _WIN32
+        closesocket(sock);
+#else
+        close(sock);
+#endif
+    }
+}
+
+bool SocketUtils::set_non_blocking(socket_t sock) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags == -1) return false;
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+bool SocketUtils::set_no_delay(socket_t sock) {
+    int flag = 1;
+    return setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, 
+                     (char*)&flag, sizeof(flag)) == 0;
+}
+
+bool SocketUtils::set_reuse_addr(socket_t sock) {
+    int flag = 1;
+    return setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, 
+                     (char*)&flag, sizeof(flag)) == 0;
+}
+
+// Keeps the socket out of processes started for a binary upgrade
+bool SocketUtils::set_close_on_exec(socket_t sock) {
+#ifdef _WIN32
+    return SetHandleInformation(reinterpret_cast<HANDLE>(sock), HANDLE_FLAG_INHERIT, 0) != 0;
+#else
+    int flags = fcntl(sock, F_GETFD, 0);
+    if (flags == -1) return false;
+    return fcntl(sock, F_SETFD, flags | FD_CLOEXEC) != -1;
+#endif
+}
+
+socket_t SocketUtils::create_socket(int family, int type, int protocol) {
+#if defined(_WIN32)
+    return socket(family, type, protocol);
+#elif defined(HYDRA_ATOMIC_CLOEXEC)
+    return socket(family, type | SOCK_CLOEXEC, protocol);
+#else
+    std::shared_lock<std::shared_mutex> lock(descriptor_mutex);
+    socket_t sock = socket(family, type, protocol);
+    if (sock != INVALID_SOCKET) set_close_on_exec(sock);
+    return sock;
+#endif
+}
+
+socket_t SocketUtils::accept_socket(socket_t listen_socket, struct sockaddr* addr, socklen_t* addr_len) {
+#if defined(_WIN32)
+    return accept(listen_socket, addr, addr_len);
+#elif defined(HYDRA_ATOMIC_CLOEXEC)
+    return accept4(listen_socket, addr, addr_len, SOCK_CLOEXEC);
+#else
+    std::shared_lock<std::shared_mutex> lock(descriptor_mutex);
+    socket_t sock = accept(listen_socket, addr, addr_len);
+    if (sock != INVALID_SOCKET) set_close_on_exec(sock);
+    return sock;
+#endif
+}
+
+#ifndef _WIN32
+pid_t SocketUtils::fork_process() {
+#ifdef HYDRA_ATOMIC_CLOEXEC
+    return fork();
+#else
+    std::unique_lock<std::shared_mutex> lock(descriptor_mutex);
+    return fork();
+#endif
+}
+#endif
+
+void SocketUtils::shutdown_socket(socket_t sock) {
+    if (sock != INVALID_SOCKET) {
+#ifdef _WIN32
+        shutdown(sock, SD_BOTH);
+#else
+        shutdown(sock, SHUT_RDWR);
+#endif
+    }
+}
+
+bool SocketUtils::has_pending_data(socket_t sock) {
+#ifdef _WIN32
+    u_long available = 0;
+    return ioctlsocket(sock, FIONREAD, &available) == 0 && available > 0;
+#else
+    int available = 0;
+    return ioctl(sock, FIONREAD, &available) == 0 && available > 0;
+#endif
+}
+
+} // namespace hydra
@@ -0,0 +1,50 @@
+#ifndef HYDRA_SOCKET_UTILS_H
+#define HYDRA_SOCKET_UTILS_H
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+typedef SOCKET socket_t;
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+typedef int socket_t;
+#define INVALID_SOCKET -1
+#define SOCKET_ERROR -1
+#endif
+
+namespace hydra {
+
+class SocketUtils {
+public:
+    static bool initialize();
+    static void cleanup();
+    static void close_socket(socket_t sock);
+    static bool set_non_blocking(socket_t sock);
+    static bool set_no_delay(socket_t sock);
+    static bool set_reuse_addr(socket_t sock);
+    static bool set_close_on_exec(socket_t sock);
+    
+    // Create sockets that a process started for a binary upgrade never
+    // inherits. Where the platform cannot set close-on-exec atomically,
+    // creating and flagging a socket is serialized against fork_process().
+    static socket_t create_socket(int family, int type, int protocol);
+    static socket_t accept_socket(socket_t listen_socket, struct sockaddr* addr, socklen_t* addr_len);
+#ifndef _WIN32
+    static pid_t fork_process();
+#endif
+    static void shutdown_socket(socket_t sock);
+    static bool has_pending_data(socket_t sock);
+};
+
+} // namespace hydra
+
+#endif // HYDRA_SOCKET_UTILS_H
@@ -0,0 +1,282 @@
+#include "traffic_capture.h"
+#include <iostream>
+#include <cstring>
+#include <ctime>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace hydra {
+
+static size_t align8(size_t value) {
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+static std::atomic<uint64_t> next_generation(1);
+
+// The chunk the current thread is filling
+struct CaptureChunk {
+    uint64_t generation;
+    size_t position;
+    size_t end;
+};
+
+static thread_local CaptureChunk current_chunk = { 0, 0, 0 };
+
+// TrafficCapture implementation
+TrafficCapture::TrafficCapture()
+    : base_(nullptr)
+    , capacity_(0)
+    , recording_(true)
+    , generation_(0)
+    , offset_(0)
+    , dropped_(0)
+#ifdef _WIN32
+    , file_handle_(INVALID_HANDLE_VALUE)
+    , mapping_handle_(nullptr)
+#else
+    , fd_(-1)
+#endif
+{
+}
+
+TrafficCapture::~TrafficCapture() {
+    close();
+}
+
+bool TrafficCapture::open(const std::string& base_filename, size_t max_size) {
+    // Records are only written into whole chunks
+    size_t min_size = sizeof(CaptureFileHeader) + CAPTURE_CHUNK_SIZE;
+    if (max_size < min_size) {
+        std::cerr << "Capture size too small: " << max_size
+                  << " bytes, at least " << min_size << " needed" << std::endl;
+        return false;
+    }
+
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+    std::string filename = base_filename + "." + std::to_string(std::time(nullptr)) +
+                           "." + std::to_string(pid);
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                              nullptr, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to create capture file " << filename << ": " << GetLastError() << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    size.QuadPart = static_cast<LONGLONG>(max_size);
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                        size.HighPart, size.LowPart, nullptr);
+    if (mapping == nullptr) {
+        std::cerr << "Failed to map capture file " << filename << ": " << GetLastError() << std::endl;
+        CloseHandle(file);
+        return false;
+    }
+
+    void* base = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, max_size);
+    if (base == nullptr) {
+        std::cerr << "Failed to map capture file " << filename << ": " << GetLastError() << std::endl;
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle_ = file;
+    mapping_handle_ = mapping;
+#else
+    int fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to create capture file " << filename << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, static_cast<off_t>(max_size)) == -1) {
+        std::cerr << "Failed to size capture file " << filename << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    void* base = mmap(nullptr, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "Failed to map capture file " << filename << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    fd_ = fd;
+#endif
+
+    filename_ = filename;
+    base_ = static_cast<char*>(base);
+    capacity_ = max_size;
+    generation_ = next_generation++;
+    start_ = std::chrono::steady_clock::now();
+    dropped_ = 0;
+
+    CaptureFileHeader header;
+    std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = CAPTURE_VERSION;
+    header.chunk_size = CAPTURE_CHUNK_SIZE;
+    header.start_time_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    std::memcpy(base_, &header, sizeof(header));
+    offset_ = sizeof(header);
+
+    return true;
+}
+
+void TrafficCapture::close() {
+    if (base_ == nullptr) return;
+
+    // Trim the file to the data actually written
+    size_t used = offset_.load();
+    if (used > capacity_) used = capacity_;
+
+#ifdef _WIN32
+    UnmapViewOfFile(base_);
+    CloseHandle(mapping_handle_);
+    LARGE_INTEGER size;
+    size.QuadPart = static_cast<LONGLONG>(used);
+    SetFilePointerEx(file_handle_, size, nullptr, FILE_BEGIN);
+    SetEndOfFile(file_handle_);
+    CloseHandle(file_handle_);
+    file_handle_ = INVALID_HANDLE_VALUE;
+    mapping_handle_ = nullptr;
+#else
+    munmap(base_, capacity_);
+    if (ftruncate(fd_, static_cast<off_t>(used)) == -1) {
+        std::cerr << "Failed to trim capture file: " << strerror(errno) << std::endl;
+    }
+    ::close(fd_);
+    fd_ = -1;
+#endif
+
+    base_ = nullptr;
+    capacity_ = 0;
+
+    uint64_t dropped = dropped_.load();
+    if (dropped > 0) {
+        std::cerr << "Capture file full, dropped " << dropped << " records" << std::endl;
+    }
+}
+
+void TrafficCapture::record(uint64_t connection_id, const char* data, size_t length) {
+    if (base_ == nullptr || length == 0 || length > UINT32_MAX) return;
+    if (!recording_.load(std::memory_order_relaxed)) return;
+
+    size_t record_size = sizeof(CaptureRecordHeader) + align8(length);
+    
+    // Start a new chunk when this thread has none in this capture or it is full
+    CaptureChunk& chunk = current_chunk;
+    if (chunk.generation != generation_ || chunk.end - chunk.position < record_size) {
+        size_t reserve = (record_size + CAPTURE_CHUNK_SIZE - 1) / CAPTURE_CHUNK_SIZE * CAPTURE_CHUNK_SIZE;
+        size_t offset = offset_.fetch_add(reserve, std::memory_order_relaxed);
+        if (offset + reserve > capacity_) {
+            chunk.generation = 0;
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        chunk.generation = generation_;
+        chunk.position = offset;
+        chunk.end = offset + reserve;
+    }
+    
+    size_t offset = chunk.position;
+    chunk.position += record_size;
+
+    CaptureRecordHeader header;
+    header.timestamp_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    header.connection_id = connection_id;
+    header.length = static_cast<uint32_t>(length);
+    header.reserved = 0;
+
+    std::memcpy(base_ + offset + sizeof(header), data, length);
+    std::memcpy(base_ + offset, &header, sizeof(header));
+}
+
+// CaptureReader implementation
+bool CaptureReader::open(const std::string& filename) {
+    file_.open(filename, std::ios::binary);
+    if (!file_.is_open()) {
+        std::cerr << "Failed to open capture file: " << filename << std::endl;
+        return false;
+    }
+
+    CaptureFileHeader header;
+    if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "Not a Hydra capture file: " << filename << std::endl;
+        return false;
+    }
+
+    if (header.version != CAPTURE_VERSION) {
+        std::cerr << "Unsupported capture version " << header.version << std::endl;
+        return false;
+    }
+
+    if (header.chunk_size < sizeof(CaptureRecordHeader) || header.chunk_size % 8 != 0) {
+        std::cerr << "Invalid capture chunk size " << header.chunk_size << std::endl;
+        return false;
+    }
+
+    chunk_size_ = header.chunk_size;
+    position_ = 0;
+    return true;
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+    CaptureRecordHeader header;
+    while (true) {
+        // Skip the unused tail of a chunk
+        uint64_t left_in_chunk = chunk_size_ - position_ % chunk_size_;
+        if (left_in_chunk < sizeof(header)) {
+            file_.ignore(static_cast<std::streamsize>(left_in_chunk));
+            position_ += left_in_chunk;
+        }
+
+        if (!file_.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+            return false;
+        }
+        position_ += sizeof(header);
+
+        if (header.length != 0) break;
+
+        left_in_chunk = (chunk_size_ - position_ % chunk_size_) % chunk_size_;
+        file_.ignore(static_cast<std::streamsize>(left_in_chunk));
+        position_ += left_in_chunk;
+    }
+
+    record.timestamp_ns = header.timestamp_ns;
+    record.connection_id = header.connection_id;
+    record.data.resize(header.length);
+
+    size_t padded = align8(header.length);
+    if (!file_.read(record.data.data(), header.length)) {
+        return false;
+    }
+    file_.ignore(static_cast<std::streamsize>(padded - header.length));
+    position_ += padded;
+
+    return true;
+}
+
+} // namespace hydra
@@ -0,0 +1,98 @@
+#ifndef HYDRA_TRAFFIC_CAPTURE_H
+#define HYDRA_TRAFFIC_CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace hydra {
+
+// Capture file layout:
+//   CaptureFileHeader
+//   Chunks of chunk_size bytes, each holding
+//   CaptureRecordHeader + payload (padded to 8 bytes), repeated
+// Every writer thread fills its own chunk. A record header with length 0,
+// or too little room for one, means the rest of the chunk is unused.
+// A record larger than a chunk spans as many whole chunks as it needs.
+static const char CAPTURE_MAGIC[8] = { 'H', 'Y', 'D', 'R', 'A', 'C', 'A', 'P' };
+static const uint32_t CAPTURE_VERSION = 1;
+static const uint32_t CAPTURE_CHUNK_SIZE = 256 * 1024;
+
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunk_size;
+    uint64_t start_time_ns;     // Wall clock time the capture was opened
+};
+
+struct CaptureRecordHeader {
+    uint64_t timestamp_ns;      // Nanoseconds since the capture was opened
+    uint64_t connection_id;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct CaptureRecord {
+    uint64_t timestamp_ns;
+    uint64_t connection_id;
+    std::vector<char> data;
+};
+
+// Appends received client data to a memory-mapped capture file.
+// Each thread reserves a chunk of the file with one atomic add and then
+// appends its records there without touching shared state, so recording
+// never takes a lock and threads do not contend on the offset for every
+// record. Once the file is full, further records are dropped and counted.
+//
+// Every process writes its own file, named <base>.<unix time>.<pid>, and
+// never opens an existing one. During a binary upgrade the old and the new
+// process therefore never share a mapped file.
+class TrafficCapture {
+public:
+    TrafficCapture();
+    ~TrafficCapture();
+
+    bool open(const std::string& base_filename, size_t max_size);
+    void close();
+    bool is_open() const { return base_ != nullptr; }
+    const std::string& get_filename() const { return filename_; }
+    void set_recording(bool recording) { recording_.store(recording, std::memory_order_relaxed); }
+
+    void record(uint64_t connection_id, const char* data, size_t length);
+    uint64_t get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    std::string filename_;
+    char* base_;
+    size_t capacity_;
+    std::atomic<bool> recording_;
+    uint64_t generation_;       // Tells thread-local chunks of older captures apart
+    std::atomic<size_t> offset_;
+    std::atomic<uint64_t> dropped_;
+    std::chrono::steady_clock::time_point start_;
+#ifdef _WIN32
+    void* file_handle_;
+    void* mapping_handle_;
+#else
+    int fd_;
+#endif
+};
+
+// Sequential reader for capture files written by TrafficCapture
+class CaptureReader {
+public:
+    bool open(const std::string& filename);
+    bool next(CaptureRecord& record);
+
+private:
+    std::ifstream file_;
+    uint64_t chunk_size_;
+    uint64_t position_;         // Offset from the end of the file header
+};
+
+} // namespace hydra
+
+#endif // HYDRA_TRAFFIC_CAPTURE_H
@@ -0,0 +1,397 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include "socket_utils.h"
+#include "traffic_capture.h"
+
+// Replays a Hydra capture file against a running Hydra instance.
+// Every captured connection gets its own client connection, so connections
+// overlap the way they did in production. A fixed pool of threads sends the
+// records in the order they are due. Each connection has at most one record
+// queued at a time, which keeps the request order within a connection.
+
+typedef std::chrono::steady_clock Clock;
+
+static const unsigned int DEFAULT_REPLAY_THREADS = 64;
+
+struct ReplayConnection {
+    uint64_t connection_id;
+    std::vector<hydra::CaptureRecord> records;
+    size_t next_record;
+    socket_t socket;
+    std::string pending;        // Response bytes read but not consumed yet
+};
+
+struct ScheduledRecord {
+    Clock::time_point due;
+    size_t connection;
+
+    bool operator>(const ScheduledRecord& other) const { return due > other.due; }
+};
+
+// Hands out queued records to the worker threads once they are due.
+// Without pacing, records are handed out at once but still in due order.
+class ReplayScheduler {
+public:
+    ReplayScheduler(size_t connections, bool paced) : remaining_(connections), paced_(paced) {}
+
+    void push(const ScheduledRecord& record) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push(record);
+        }
+        cv_.notify_one();
+    }
+
+    // Called when a connection has sent its last record
+    void finish() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--remaining_ == 0) {
+            cv_.notify_all();
+        }
+    }
+
+    bool pop(ScheduledRecord& record) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            if (queue_.empty()) {
+                if (remaining_ == 0) return false;
+                cv_.wait(lock);
+                continue;
+            }
+
+            Clock::time_point due = queue_.top().due;
+            if (paced_ && due > Clock::now()) {
+                cv_.wait_until(lock, due);
+                continue;
+            }
+
+            record = queue_.top();
+            queue_.pop();
+            return true;
+        }
+    }
+
+private:
+    std::priority_queue<ScheduledRecord, std::vector<ScheduledRecord>, std::greater<ScheduledRecord>> queue_;
+    size_t remaining_;
+    bool paced_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+struct ReplayContext {
+    std::vector<ReplayConnection> connections;
+    std::string host;
+    uint16_t port;
+    double speed;               // <= 0 means as fast as possible
+    uint64_t base_timestamp_ns;
+    Clock::time_point start;
+};
+
+struct ReplayStats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> failures{0};
+    std::mutex latency_mutex;
+    std::vector<double> latencies_us;
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " <capture-file> <host> <port> [speed] [threads]" << std::endl;
+    std::cerr << "  speed: 1 = original timing (default), N = N times faster, max = no delays" << std::endl;
+    std::cerr << "  threads: number of sending threads (default " << DEFAULT_REPLAY_THREADS << ")" << std::endl;
+}
+
+static socket_t connect_to(const std::string& host, uint16_t port) {
+    struct addrinfo hints, *result = nullptr;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    std::string port_str = std::to_string(port);
+    if (getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result) != 0) {
+        std::cerr << "Failed to resolve " << host << std::endl;
+        return INVALID_SOCKET;
+    }
+
+    socket_t sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (sock == INVALID_SOCKET) {
+        freeaddrinfo(result);
+        return INVALID_SOCKET;
+    }
+
+    if (connect(sock, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR) {
+        hydra::SocketUtils::close_socket(sock);
+        freeaddrinfo(result);
+        return INVALID_SOCKET;
+    }
+
+    freeaddrinfo(result);
+    hydra::SocketUtils::set_no_delay(sock);
+
+    // Never hang forever on a missing response
+#ifdef _WIN32
+    DWORD timeout = 5000;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+
+    return sock;
+}
+
+static bool send_all(socket_t sock, const char* data, size_t length) {
+    size_t total_sent = 0;
+    while (total_sent < length) {
+#ifdef _WIN32
+        int sent = send(sock, data + total_sent, (int)(length - total_sent), 0);
+#else
+        ssize_t sent = send(sock, data + total_sent, length - total_sent, 0);
+#endif
+        if (sent == SOCKET_ERROR) return false;
+        total_sent += sent;
+    }
+    return true;
+}
+
+// Reads a single HTTP response (headers plus Content-Length body) and
+// reports whether the server asked to close the connection
+static bool read_response(socket_t sock, std::string& pending, bool& connection_close) {
+    char chunk[16384];
+    size_t header_end = std::string::npos;
+    size_t content_length = 0;
+    connection_close = false;
+
+    while (true) {
+        if (header_end == std::string::npos) {
+            header_end = pending.find("\r\n\r\n");
+            if (header_end != std::string::npos) {
+                std::string headers = pending.substr(0, header_end);
+                std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+                size_t pos = headers.find("content-length:");
+                if (pos != std::string::npos) {
+                    content_length = std::strtoul(headers.c_str() + pos + 15, nullptr, 10);
+                }
+                pos = headers.find("connection:");
+                if (pos != std::string::npos) {
+                    size_t value = headers.find_first_not_of(" \t", pos + 11);
+                    connection_close = value != std::string::npos && headers.compare(value, 5, "close") == 0;
+                }
+            }
+        }
+
+        if (header_end != std::string::npos && pending.size() >= header_end + 4 + content_length) {
+            pending.erase(0, header_end + 4 + content_length);
+            return true;
+        }
+
+#ifdef _WIN32
+        int bytes_read = recv(sock, chunk, (int)sizeof(chunk), 0);
+#else
+        ssize_t bytes_read = recv(sock, chunk, sizeof(chunk), 0);
+#endif
+        if (bytes_read <= 0) return false;
+        pending.append(chunk, static_cast<size_t>(bytes_read));
+    }
+}
+
+// Without a speed the captured timing still decides the order of records
+static Clock::time_point due_time(const ReplayContext& context, const hydra::CaptureRecord& record) {
+    double speed = context.speed > 0.0 ? context.speed : 1.0;
+    return context.start + std::chrono::nanoseconds(static_cast<int64_t>(
+        (record.timestamp_ns - context.base_timestamp_ns) / speed));
+}
+
+static void replay_record(ReplayConnection& connection, const ReplayContext& context, ReplayStats& stats) {
+    const hydra::CaptureRecord& record = connection.records[connection.next_record];
+
+    if (connection.socket == INVALID_SOCKET) {
+        connection.socket = connect_to(context.host, context.port);
+        if (connection.socket == INVALID_SOCKET) {
+            stats.failures++;
+            return;
+        }
+        connection.pending.clear();
+    }
+
+    auto sent_at = Clock::now();
+    bool connection_close = false;
+    if (!send_all(connection.socket, record.data.data(), record.data.size()) ||
+        !read_response(connection.socket, connection.pending, connection_close)) {
+        stats.failures++;
+        hydra::SocketUtils::close_socket(connection.socket);
+        connection.socket = INVALID_SOCKET;
+        return;
+    }
+
+    double latency_us = std::chrono::duration<double, std::micro>(Clock::now() - sent_at).count();
+    stats.requests++;
+
+    // The server ended the connection (e.g. max_requests_per_connection);
+    // the next record of this connection reconnects
+    if (connection_close) {
+        hydra::SocketUtils::close_socket(connection.socket);
+        connection.socket = INVALID_SOCKET;
+    }
+    {
+        std::lock_guard<std::mutex> lock(stats.latency_mutex);
+        stats.latencies_us.push_back(latency_us);
+    }
+}
+
+static void replay_worker(ReplayContext& context, ReplayScheduler& scheduler, ReplayStats& stats) {
+    ScheduledRecord item;
+    while (scheduler.pop(item)) {
+        ReplayConnection& connection = context.connections[item.connection];
+        replay_record(connection, context, stats);
+
+        if (++connection.next_record < connection.records.size()) {
+            const hydra::CaptureRecord& next = connection.records[connection.next_record];
+            scheduler.push(ScheduledRecord{ due_time(context, next), item.connection });
+        } else {
+            hydra::SocketUtils::close_socket(connection.socket);
+            connection.socket = INVALID_SOCKET;
+            scheduler.finish();
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    std::string capture_file = argv[1];
+    ReplayContext context;
+    context.host = argv[2];
+    context.port = static_cast<uint16_t>(std::atoi(argv[3]));
+
+    context.speed = 1.0;
+    if (argc > 4) {
+        std::string speed_str = argv[4];
+        if (speed_str == "max") {
+            context.speed = 0.0;
+        } else {
+            context.speed = std::atof(speed_str.c_str());
+            if (context.speed <= 0.0) {
+                print_usage(argv[0]);
+                return 1;
+            }
+        }
+    }
+
+    unsigned int thread_count = DEFAULT_REPLAY_THREADS;
+    if (argc > 5) {
+        int threads = std::atoi(argv[5]);
+        if (threads <= 0) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        thread_count = static_cast<unsigned int>(threads);
+    }
+
+    // Group records per connection, keeping the captured order
+    hydra::CaptureReader reader;
+    if (!reader.open(capture_file)) {
+        return 1;
+    }
+
+    auto& connections = context.connections;
+    std::map<uint64_t, size_t> connection_index;
+    context.base_timestamp_ns = UINT64_MAX;
+    size_t record_count = 0;
+
+    hydra::CaptureRecord record;
+    while (reader.next(record)) {
+        auto it = connection_index.find(record.connection_id);
+        if (it == connection_index.end()) {
+            it = connection_index.emplace(record.connection_id, connections.size()).first;
+            connections.push_back(ReplayConnection{ record.connection_id, {}, 0, INVALID_SOCKET, std::string() });
+        }
+        context.base_timestamp_ns = std::min(context.base_timestamp_ns, record.timestamp_ns);
+        connections[it->second].records.push_back(record);
+        record_count++;
+    }
+
+    if (record_count == 0) {
+        std::cerr << "Capture file contains no records" << std::endl;
+        return 1;
+    }
+
+    std::cout << "Replaying " << record_count << " requests on " << connections.size()
+              << " connections to " << context.host << ":" << context.port;
+    if (context.speed > 0.0) {
+        std::cout << " at " << context.speed << "x speed" << std::endl;
+    } else {
+        std::cout << " as fast as possible" << std::endl;
+    }
+
+    if (!hydra::SocketUtils::initialize()) {
+        std::cerr << "Failed to initialize sockets" << std::endl;
+        return 1;
+    }
+
+#ifndef _WIN32
+    // A server closing the connection must fail the send, not kill the tool
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    if (thread_count > connections.size()) {
+        thread_count = static_cast<unsigned int>(connections.size());
+    }
+
+    ReplayStats stats;
+    ReplayScheduler scheduler(connections.size(), context.speed > 0.0);
+
+    context.start = Clock::now();
+    for (size_t i = 0; i < connections.size(); ++i) {
+        scheduler.push(ScheduledRecord{ due_time(context, connections[i].records.front()), i });
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < thread_count; ++i) {
+        threads.emplace_back(replay_worker, std::ref(context), std::ref(scheduler), std::ref(stats));
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - context.start).count();
+
+    hydra::SocketUtils::cleanup();
+
+    std::cout << "==================================" << std::endl;
+    std::cout << "  Requests:   " << stats.requests.load() << std::endl;
+    std::cout << "  Failures:   " << stats.failures.load() << std::endl;
+    std::cout << "  Elapsed:    " << elapsed << " s" << std::endl;
+    if (elapsed > 0.0) {
+        std::cout << "  Throughput: " << stats.requests.load() / elapsed << " req/s" << std::endl;
+    }
+
+    auto& latencies = stats.latencies_us;
+    if (!latencies.empty()) {
+        std::sort(latencies.begin(), latencies.end());
+        double sum = 0.0;
+        for (double latency : latencies) sum += latency;
+        std::cout << "  Latency avg: " << sum / latencies.size() << " us" << std::endl;
+        std::cout << "  Latency p50: " << latencies[latencies.size() / 2] << " us" << std::endl;
+        std::cout << "  Latency p99: " << latencies[(latencies.size() * 99) / 100] << " us" << std::endl;
+    }
+
+    return stats.failures.load() == 0 ? 0 : 1;
+}